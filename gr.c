@@ -42,6 +42,10 @@ MESSAGE TYPE:
             - check sequence number, ... 
     - If the sink receive the message : WE ARE DONE
         - print some stats about the messages
+- REPAIR : gradient repair request
+    - Sent by a moving node (status="1" in the xml file) when its predicted position
+      is out of range of its parent, the node forgets its gradient
+    - Neighbors with a gradient answer with a BUILD message (local, no new sequence number)
 
 TODO : 
     - building the gradient
@@ -67,8 +71,9 @@ model_t model =  {
 #define STATIC  0
 #define MOVING  1
 
-#define BUILD 0
-#define DATA  1
+#define BUILD  0
+#define DATA   1
+#define REPAIR 2
 
 #define NODE_OFF 0
 #define NODE_ON 1
@@ -76,21 +81,41 @@ model_t model =  {
 #define MES_NO -1
 #define MES_BU 0
 
-#define BUFFER 10
+#define BUFFER 10 // default forwarding queue size, <init Buffer="..."/> in the xml file
 #define SEQUENCE 10
+#define NEIGHBOR 32
+
+#define ETX_WINDOW 20  // number of BUILD rounds the link estimation is averaged over
+#define ETX_MAX 20.0   // cost of a link with a delivery ratio close to 0
 
 
 /* ************************************************** */
 /* *************** STRUCTURE DEFINITION ************* */
 /* ************************************************** */
 /* Common entity data */
+struct strategy;
 struct entitydata{
     uint64_t Delay; // short delay before sending a message
     uint64_t Period;
     uint64_t Jitter;
     uint64_t TimeSpace;
+    int Buffer; // forwarding queue size
+    uint64_t MoveCheck; // interval between two position checks of a moving node
+    double Range;       // radio range, required when there are moving nodes
 
     int packet_seq;
+    struct strategy *strategy; // forwarding strategy selected with the "strategy" init parameter
+
+    int no_data_tx;          // DATA transmissions (origin and forwards)
+    int no_data_delivered;   // distinct DATA messages received by the sink
+    int no_data_duplicate;   // DATA messages received more than once by the sink
+    int no_data_skipped;     // DATA messages not sent because the source was repairing its gradient
+    unsigned char *delivered;
+    int delivered_size;
+
+    int no_repair;           // gradients invalidated by moving nodes
+    double mobile_distance;  // distance travelled by the moving nodes
+    double mobile_time;      // time the moving nodes have been tracked (s)
 };
 
 /* Data Packet header */
@@ -100,6 +125,7 @@ struct packet_header {
     int       p_type;
     int       p_seqno;
     int       p_depth;
+    double    p_cost;
     int       p_origin;
     int       p_status;
     double    p_pos_x;
@@ -107,20 +133,44 @@ struct packet_header {
     uint64_t  p_stamp;
 };
 
+/* Forwarding strategy
+ * - parent  : BUILD reception, updates the gradient, returns > 0 if it changed
+ * - forward : DATA reception, returns the fwd decision (0 do not forward, 1 forward, 2 sink, 3 buffer drop)
+ * - backoff : delay before sending the BUILD or forwarding the DATA message
+ */
+struct strategy {
+    char     *name;
+    int      (*parent)(call_t *c, struct packet_header *header);
+    int      (*forward)(call_t *c, struct packet_header *header);
+    uint64_t (*backoff)(call_t *c, struct packet_header *header);
+};
+
+/* Link estimation from the overheard BUILD messages */
+struct neighbor {
+    int id;
+    int seqno;      // last BUILD sequence number received from this neighbor
+    int recv;       // BUILD rounds received
+    int expected;   // BUILD rounds sent by the neighbor
+};
+
 /* Private node data */
 struct _node_private {
     int seqno;
     int depth;
+    double cost;
     int from;
     int type;
     int status;
     int msg_status;
     int node_status;
     int *overhead;
-    struct packet_header p[BUFFER];
+    struct packet_header *p;
     int seq[SEQUENCE];
     int buffer_pointer;
     int seq_pointer;
+    struct neighbor nbr[NEIGHBOR];
+    int nbr_count;
+    int nbr_first;   // first BUILD sequence number heard by this node
 
     int no_packet_sent;
     int no_packet_recv;
@@ -131,20 +181,57 @@ struct _node_private {
     uint64_t timestamp ;
     double cosx ;
     double sinx ;
+    double pos_x ;    // position at timestamp
+    double pos_y ;
+    double from_x ;   // position of the parent
+    double from_y ;
+    int lost_seqno ;  // gradient dropped by the last repair
+    int lost_depth ;
+    double lost_cost ;
+    int no_repair ;
 };
 
 /* ************************************************** */
 /* ************************************************** */
+/* tx_build argument when answering a REPAIR message */
+static int repair_answer;
+#define REPAIR_ANSWER ((void *) &repair_answer)
+
 int tx_build(call_t *c, void *args);
 int tx_data(call_t *c, void *args);
 int tx_forward(call_t *c, void *args);
+int tx_repair(call_t *c, void *args);
 int move(call_t *c, void *args);
 int my_energy(call_t *c, void *args);
 void add_seq(call_t *c, int s);
 int check_seq(call_t *c, int s);
 int updateposition(call_t *c);
 double d(int i, int j);
-double dpos(int x_1, int y_1, int x_2, int y_2);
+double dpos(double x_1, double y_1, double x_2, double y_2);
+int gradient_parent(call_t *c, struct packet_header *header);
+int accept_data(call_t *c, struct packet_header *header);
+int gradient_forward(call_t *c, struct packet_header *header);
+uint64_t gradient_backoff(call_t *c, struct packet_header *header);
+int strict_forward(call_t *c, struct packet_header *header);
+double link_etx(call_t *c, struct packet_header *header);
+int etx_parent(call_t *c, struct packet_header *header);
+int etx_forward(call_t *c, struct packet_header *header);
+int add_delivered(call_t *c, int s);
+
+/* ************************************************** */
+/* ************************************************** */
+/* Registered forwarding strategies, the first one is the default
+ * <init strategy="gradient"/> in the xml file
+ * - gradient : original gradient routing
+ * - strict   : only forward DATA coming from exactly one hop deeper (duplicate reduction)
+ * - etx      : gradient of the cumulative expected transmission count instead of the hop count
+ */
+struct strategy strategies[] = {
+    {"gradient", gradient_parent, gradient_forward, gradient_backoff},
+    {"strict",   gradient_parent, strict_forward,   gradient_backoff},
+    {"etx",      etx_parent,      etx_forward,      gradient_backoff},
+    {NULL, NULL, NULL, NULL}
+};
 
 /* ************************************************** */
 /* ************************************************** */
@@ -161,7 +248,7 @@ double d(i,j){
     return d;
 }
 
-double dpos(x_1,y_1,x_2,y_2){
+double dpos(double x_1, double y_1, double x_2, double y_2){
     // Compte the distance between two nodes based on their (x,y) position
     // return the distance
     double d;
@@ -185,7 +272,20 @@ int init(call_t *c, void *params) {
     entitydata->Period     = 10000000000;  // 10s
     entitydata->Jitter     = 50000000;     // 0.05s
     entitydata->TimeSpace  = 1000000000;   // 1s
+    entitydata->Buffer     = BUFFER;
+    entitydata->MoveCheck  = 1000000000;   // 1s
+    entitydata->Range      = 0;
     entitydata->packet_seq = 0;
+    entitydata->strategy   = &strategies[0];
+    entitydata->no_data_tx        = 0;
+    entitydata->no_data_delivered = 0;
+    entitydata->no_data_duplicate = 0;
+    entitydata->no_data_skipped   = 0;
+    entitydata->delivered      = NULL;
+    entitydata->delivered_size = 0;
+    entitydata->no_repair       = 0;
+    entitydata->mobile_distance = 0;
+    entitydata->mobile_time     = 0;
 
     /* reading the "init" markup from the xml config file */
     das_init_traverse(params);
@@ -210,6 +310,34 @@ int init(call_t *c, void *params) {
                 goto error;
             }
         }    
+        if (!strcmp(param->key, "Buffer")) {
+            if (get_param_integer(param->value, &(entitydata->Buffer)) || entitydata->Buffer < 2) {
+                goto error;
+            }
+        }
+        if (!strcmp(param->key, "MoveCheck")) {
+            if (get_param_time(param->value, &(entitydata->MoveCheck))) {
+                goto error;
+            }
+        }
+        if (!strcmp(param->key, "Range")) {
+            if (get_param_double(param->value, &(entitydata->Range))) {
+                goto error;
+            }
+        }
+        if (!strcmp(param->key, "strategy")) {
+            struct strategy *s;
+            for (s = strategies ; s->name != NULL ; s++) {
+                if (!strcmp(param->value, s->name)) {
+                    break;
+                }
+            }
+            if (s->name == NULL) {
+                fprintf(stderr, "gr: unknown strategy '%s'\n", param->value);
+                goto error;
+            }
+            entitydata->strategy = s;
+        }
     } 
     set_entity_private_data(c, entitydata);
     return 0;
@@ -222,6 +350,24 @@ int init(call_t *c, void *params) {
 int destroy(call_t *c) {
     // destroying the entitydata structure 
     // can be usefull to put some statistics here (end of simulation)
+    struct entitydata *entitydata = get_entity_private_data(c);
+    #ifdef STATS
+        // skipped messages are lost because of mobility, they count in the ratio
+        int offered = entitydata->packet_seq + entitydata->no_data_skipped;
+        printf("[SUMMARY] strategy=%s generated=%i skipped=%i delivered=%i duplicate=%i ratio=%lf data_tx=%i tx_per_delivered=%lf speed=%lf repair=%i\n",
+                entitydata->strategy->name,
+                entitydata->packet_seq, entitydata->no_data_skipped,
+                entitydata->no_data_delivered, entitydata->no_data_duplicate,
+                offered ? (double) entitydata->no_data_delivered / offered : 0,
+                entitydata->no_data_tx,
+                entitydata->no_data_delivered ? (double) entitydata->no_data_tx / entitydata->no_data_delivered : 0,
+                entitydata->mobile_time > 0 ? entitydata->mobile_distance / entitydata->mobile_time : 0,
+                entitydata->no_repair);
+    #endif
+    if (entitydata->delivered) {
+        free(entitydata->delivered);
+    }
+    free(entitydata);
     return 0;
 }
 
@@ -232,13 +378,14 @@ int setnode(call_t *c, void *params) {
     // create the local variable of a node
     // All variable for each node is stored in  _node_private structure (see above)
     struct _node_private *nodedata = malloc(sizeof(struct _node_private));
-    //struct entitydata *entitydata = get_entity_private_data(c);
+    struct entitydata *entitydata = get_entity_private_data(c);
     int i = get_entity_links_down_nbr(c);
     param_t *param;
 
     /* default values */
     nodedata->seqno = -1;
     nodedata->depth = -1;
+    nodedata->cost = -1;
     nodedata->from = -1;
     nodedata->status = STATIC;
     nodedata->msg_status = MES_NO;
@@ -246,6 +393,8 @@ int setnode(call_t *c, void *params) {
     nodedata->node_status = NODE_OFF;
     nodedata->buffer_pointer = 0;
     nodedata->seq_pointer    = 0;
+    nodedata->nbr_count      = 0;
+    nodedata->nbr_first      = -1;
     nodedata->no_packet_sent = 0;
     nodedata->no_packet_recv = 0;
 
@@ -254,6 +403,14 @@ int setnode(call_t *c, void *params) {
     nodedata->timestamp = 0;
     nodedata->cosx = 0;
     nodedata->sinx = 0;
+    nodedata->pos_x = 0;
+    nodedata->pos_y = 0;
+    nodedata->from_x = 0;
+    nodedata->from_y = 0;
+    nodedata->no_repair = 0;
+    nodedata->lost_seqno = -1;
+    nodedata->lost_depth = -1;
+    nodedata->lost_cost = -1;
 
     /* get parameters */
     das_init_traverse(params);
@@ -263,6 +420,17 @@ int setnode(call_t *c, void *params) {
                 goto error;
             }
         }
+        if (!strcmp(param->key, "status")) {
+            if (get_param_integer(param->value, &(nodedata->status))) {
+                goto error;
+            }
+        }
+    }
+    
+    /* a moving node needs the radio range to know when it leaves its parent */
+    if (nodedata->status == MOVING && entitydata->Range <= 0) {
+        fprintf(stderr, "gr: node %i is moving, Range must be set in the init markup\n", c->node);
+        goto error;
     }
     
     /*define node 0 as the sink, this can be decided by type in the xml file
@@ -272,6 +440,9 @@ int setnode(call_t *c, void *params) {
         nodedata->type = SINK;
     }
 
+    /* alloc forwarding queue */
+    nodedata->p = malloc(sizeof(struct packet_header) * entitydata->Buffer);
+
     /* alloc overhead memory */
     if (i) { nodedata->overhead = malloc(sizeof(int) * i); } 
     else   { nodedata->overhead = NULL; }
@@ -301,11 +472,16 @@ int unsetnode(call_t *c) {
         printf("(%i) %i %i %i %i\n", 
                 c->node,nodedata->depth,
                 nodedata->no_packet_sent,nodedata->no_packet_recv,nodedata->no_packet_drop); 
+        if (nodedata->status == MOVING) {
+            printf("[MOBILITY] (%i) %lf %lf %i\n", 
+                    c->node,nodedata->speed,nodedata->distance,nodedata->no_repair);
+        }
     #endif    
 
     if (nodedata->overhead) {
         free(nodedata->overhead);
     }
+    free(nodedata->p);
     free(nodedata);
     return 0;
 }
@@ -334,6 +510,7 @@ int bootstrap(call_t *c) {
       nodedata->seqno = 0;
       nodedata->from = c->node;
       nodedata->depth = 0;
+      nodedata->cost = 0;
       nodedata->node_status = NODE_ON;
       scheduler_add_callback(get_time() + 0, c, tx_build, NULL);
     } else { 
@@ -346,6 +523,14 @@ int bootstrap(call_t *c) {
                              get_random_time_range(0,entitydata->TimeSpace), 
                              c, tx_data, NULL);
         }
+        // moving nodes track their position
+        // <default status="1"/> or <node id="..." status="1"/> in the xml file
+        if (nodedata->status == MOVING) {
+            nodedata->pos_x = get_node_position(c->node)->x;
+            nodedata->pos_y = get_node_position(c->node)->y;
+            nodedata->timestamp = get_time();
+            scheduler_add_callback(get_time() + entitydata->MoveCheck, c, move, NULL);
+        }
     }
     return 0;
 }
@@ -356,7 +541,28 @@ int ioctl(call_t *c, int option, void *in, void **out) {
 }
 
 int updateposition(call_t *c){
-    // useless for us here
+    // update the speed and heading of a moving node
+    // from the distance travelled since the last update
+    struct _node_private *nodedata = get_node_private_data(c);
+    struct entitydata *entitydata = get_entity_private_data(c);
+    position_t *position = get_node_position(c->node);
+    double dt = (get_time() - nodedata->timestamp) / 1000000000.0;
+    double step = dpos(position->x, position->y, nodedata->pos_x, nodedata->pos_y);
+
+    if (dt <= 0) {
+        return 0;
+    }
+    if (step > 0) {
+        nodedata->cosx = (position->x - nodedata->pos_x) / step;
+        nodedata->sinx = (position->y - nodedata->pos_y) / step;
+    }
+    nodedata->speed = step / dt;
+    nodedata->distance += step;
+    nodedata->pos_x = position->x;
+    nodedata->pos_y = position->y;
+    nodedata->timestamp = get_time();
+    entitydata->mobile_distance += step;
+    entitydata->mobile_time += dt;
     return 0;
 }
 
@@ -365,13 +571,21 @@ int updateposition(call_t *c){
 /* ************************************************** */
 int tx_build(call_t *c, void *args) {
     // transmitting build message
+    // args == REPAIR_ANSWER: answer to a REPAIR message, the sink does not start a new gradient
     struct _node_private *nodedata = get_node_private_data(c);
     struct entitydata *entitydata = get_entity_private_data(c);
     call_t c0 = {get_entity_bindings_down(c)->elts[0], c->node, c->entity};
     destination_t destination = {BROADCAST_ADDR, {-1, -1, -1}};
-    packet_t *packet = packet_alloc(c, nodedata->overhead[0] + sizeof(struct packet_header) );
-    struct packet_header *header = (struct packet_header *) (packet->data + nodedata->overhead[0]);
+    packet_t *packet;
+    struct packet_header *header;
 
+    /* the gradient was dropped (moving node) since this message was scheduled */
+    if (nodedata->node_status != NODE_ON || nodedata->depth < 0) {
+        nodedata->msg_status = MES_NO;
+        return -1;
+    }
+    packet = packet_alloc(c, nodedata->overhead[0] + sizeof(struct packet_header) );
+    header = (struct packet_header *) (packet->data + nodedata->overhead[0]);
 
     /* set mac header */
     if (SET_HEADER(&c0, packet, &destination) == -1) {
@@ -382,7 +596,11 @@ int tx_build(call_t *c, void *args) {
     header->p_dst = -1;
     header->p_type = BUILD;
     header->p_seqno = nodedata->seqno; 
+    if (nodedata->type == SINK && args == REPAIR_ANSWER) {
+        header->p_seqno = nodedata->seqno - 1;
+    }
     header->p_depth = nodedata->depth;
+    header->p_cost = nodedata->cost;
     header->p_stamp = get_time();
     header->p_origin = c->node;
     header->p_pos_x = get_node_position(c->node)->x;
@@ -396,7 +614,7 @@ int tx_build(call_t *c, void *args) {
 
     TX(&c0, packet);
     
-    if (nodedata->type == SINK) {
+    if (nodedata->type == SINK && args != REPAIR_ANSWER) {
         nodedata->seqno ++;
         // reschedule gradient build after 10*entitydata->Period
         scheduler_add_callback(get_time() + 10*entitydata->Period, c, tx_build, NULL);
@@ -404,6 +622,39 @@ int tx_build(call_t *c, void *args) {
     return 1;
 }
 
+int tx_repair(call_t *c, void *args) {
+    // asking the neighbors for their gradient (local broadcast)
+    // the header carries the gradient the node had before the repair
+    // and the position predicted for the next check
+    struct _node_private *nodedata = get_node_private_data(c);
+    struct entitydata *entitydata = get_entity_private_data(c);
+    double horizon = entitydata->MoveCheck / 1000000000.0;
+    call_t c0 = {get_entity_bindings_down(c)->elts[0], c->node, c->entity};
+    destination_t destination = {BROADCAST_ADDR, {-1, -1, -1}};
+    packet_t *packet = packet_alloc(c, nodedata->overhead[0] + sizeof(struct packet_header) );
+    struct packet_header *header = (struct packet_header *) (packet->data + nodedata->overhead[0]);
+
+    /* set mac header */
+    if (SET_HEADER(&c0, packet, &destination) == -1) {
+        packet_dealloc(packet);
+        return -1;
+    }
+    header->p_src = c->node;
+    header->p_dst = -1;
+    header->p_type = REPAIR;
+    header->p_seqno = nodedata->lost_seqno; 
+    header->p_depth = nodedata->lost_depth;
+    header->p_cost = nodedata->lost_cost;
+    header->p_stamp = get_time();
+    header->p_origin = c->node;
+    header->p_pos_x = nodedata->pos_x + nodedata->speed * horizon * nodedata->cosx;
+    header->p_pos_y = nodedata->pos_y + nodedata->speed * horizon * nodedata->sinx;
+    header->p_status = nodedata->status;
+
+    TX(&c0, packet);
+    return 1;
+}
+
 int tx_data(call_t *c, void *args) {
     // transmitting data messages
     struct _node_private *nodedata = get_node_private_data(c);
@@ -414,6 +665,11 @@ int tx_data(call_t *c, void *args) {
     struct entitydata *entitydata = get_entity_private_data(c);
 
     if ( nodedata->node_status != NODE_ON ){
+        // no gradient yet, or dropped by move(): in the latter case the message is lost
+        if ( nodedata->no_repair > 0 ) {
+            entitydata->no_data_skipped ++;
+        }
+        packet_dealloc(packet);
         scheduler_add_callback(get_time() + 
                                 entitydata->Period + get_random_time_range(0,entitydata->Jitter), 
                                 c, tx_data, NULL);    
@@ -432,6 +688,7 @@ int tx_data(call_t *c, void *args) {
     header->p_dst = -1;
     header->p_type = DATA;
     header->p_depth = nodedata->depth;
+    header->p_cost = nodedata->cost;
     header->p_stamp = get_time();
     header->p_origin = c->node;
     header->p_pos_x = get_node_position(c->node)->x;
@@ -439,6 +696,7 @@ int tx_data(call_t *c, void *args) {
     header->p_status = nodedata->status;
     nodedata->no_packet_sent ++;
     entitydata->packet_seq ++;
+    entitydata->no_data_tx ++;
     header->p_seqno =  entitydata->packet_seq; 
 
     #ifdef DEBUG_T   
@@ -457,6 +715,12 @@ int tx_data(call_t *c, void *args) {
 int tx_forward(call_t *c, void *args) {
     // forwarding other nodes' messages
     struct _node_private *nodedata = get_node_private_data(c);
+    // the gradient was dropped by move(), hold the queue until the node rejoins
+    if ( nodedata->buffer_pointer > 0 && nodedata->node_status != NODE_ON ) {
+        struct entitydata *entitydata = get_entity_private_data(c);
+        scheduler_add_callback(get_time() + entitydata->MoveCheck, c, tx_forward, NULL);
+        return 0;
+    }
     nodedata->buffer_pointer -- ;
     if ( nodedata->buffer_pointer < 0 ) {
         nodedata->buffer_pointer = 0;
@@ -479,6 +743,7 @@ int tx_forward(call_t *c, void *args) {
     header->p_dst     = -1 ;
     header->p_type    = DATA ;
     header->p_depth   = nodedata->depth ;
+    header->p_cost    = nodedata->cost ;
     header->p_seqno   = (nodedata->p[0]).p_seqno ; 
     header->p_origin  = (nodedata->p[0]).p_origin ;
     header->p_pos_x   = (nodedata->p[0]).p_pos_x;
@@ -497,6 +762,7 @@ int tx_forward(call_t *c, void *args) {
             nodedata->p[i].p_type    = nodedata->p[i+1].p_type   ;
             nodedata->p[i].p_seqno   = nodedata->p[i+1].p_seqno  ;
             nodedata->p[i].p_depth   = nodedata->p[i+1].p_depth  ;
+            nodedata->p[i].p_cost    = nodedata->p[i+1].p_cost   ;
             nodedata->p[i].p_origin  = nodedata->p[i+1].p_origin ;
             nodedata->p[i].p_status  = nodedata->p[i+1].p_status ;
             nodedata->p[i].p_stamp   = nodedata->p[i+1].p_stamp  ;
@@ -514,12 +780,46 @@ int tx_forward(call_t *c, void *args) {
     if ( nodedata->buffer_pointer > 0 ) {
         scheduler_add_callback(get_time() + get_random_time_range(0,entitydata->Jitter), c, tx_forward, NULL);
     }
+    entitydata->no_data_tx ++;
     TX(&c0, packet);
     return 1;
 }
 
 int move(call_t *c, void *args) {
-    // useless for us here
+    // periodic check of a moving node
+    // predict the position at the next check from speed and heading,
+    // if it will be out of range of the parent, forget the gradient and ask the neighbors
+    struct _node_private *nodedata = get_node_private_data(c);
+    struct entitydata *entitydata = get_entity_private_data(c);
+    double horizon = entitydata->MoveCheck / 1000000000.0;
+    double x, y;
+
+    updateposition(c);
+    x = nodedata->pos_x + nodedata->speed * horizon * nodedata->cosx;
+    y = nodedata->pos_y + nodedata->speed * horizon * nodedata->sinx;
+
+    if (nodedata->node_status == NODE_ON 
+        && dpos(x, y, nodedata->from_x, nodedata->from_y) > entitydata->Range) {
+        // any BUILD message will be accepted again, except from our own subtree
+        nodedata->lost_seqno = nodedata->seqno;
+        nodedata->lost_depth = nodedata->depth;
+        nodedata->lost_cost = nodedata->cost;
+        nodedata->seqno = -1;
+        nodedata->depth = -1;
+        nodedata->cost = -1;
+        nodedata->from = -1;
+        nodedata->node_status = NODE_OFF;
+        nodedata->no_repair ++;
+        entitydata->no_repair ++;
+#ifdef DEBUG_T    
+        printf("%lli (%03i) \t repair\n", get_time(),c->node);
+#endif
+    }
+    if (nodedata->node_status == NODE_OFF) {
+        tx_repair(c, NULL);
+    }
+
+    scheduler_add_callback(get_time() + entitydata->MoveCheck, c, move, NULL);
     return 0;
 }
 
@@ -565,6 +865,181 @@ int check_seq(call_t *c, int s) {
         return 1;
 }
 
+int add_delivered(call_t *c, int s) {
+    // mark a data packet as delivered to the sink
+    // return 1 the first time, -1 for a duplicate
+    struct entitydata *entitydata = get_entity_private_data(c);
+    if ( s >= entitydata->delivered_size ) {
+        // grow geometrically, the sink calls this for every message
+        int size = entitydata->delivered_size ? entitydata->delivered_size : 64;
+        unsigned char *delivered;
+        while ( size <= s ) {
+            size *= 2;
+        }
+        delivered = realloc(entitydata->delivered, size);
+        if ( delivered == NULL ) { // cannot track it, count it as new
+            return 1;
+        }
+        memset(delivered + entitydata->delivered_size, 0, size - entitydata->delivered_size);
+        entitydata->delivered = delivered;
+        entitydata->delivered_size = size;
+    }
+    if ( entitydata->delivered[s] ) {
+        return -1;
+    }
+    entitydata->delivered[s] = 1;
+    return 1;
+}
+
+
+/* ************************************************** */
+/* ************************************************** */
+int gradient_parent(call_t *c, struct packet_header *header) {
+    // original gradient: hop count to the sink
+    // take any newer gradient, or a shorter path in the current one
+    struct _node_private *nodedata = get_node_private_data(c);
+    int helper = 0;
+    if( nodedata->seqno < header->p_seqno ) {
+        nodedata->seqno = header->p_seqno;
+        nodedata->depth = header->p_depth + 1;
+        nodedata->cost = nodedata->depth;
+        nodedata->from = header->p_src;
+        helper++;
+    }
+    if( nodedata->depth > (header->p_depth + 1) ) {
+        nodedata->seqno = header->p_seqno;
+        nodedata->depth = header->p_depth + 1;
+        nodedata->cost = nodedata->depth;
+        nodedata->from = header->p_src;
+        helper++;
+    }
+    return helper;
+}
+
+int accept_data(call_t *c, struct packet_header *header) {
+    // common to all strategies, once the node is eligible to forward header
+    // return 1 forward, 2 sink, 3 buffer drop (or duplicate)
+    struct _node_private *nodedata = get_node_private_data(c);
+    struct entitydata *entitydata = get_entity_private_data(c);
+    if ( nodedata->buffer_pointer < entitydata->Buffer - 1  && check_seq(c, header->p_seqno) == 1 ) {
+        if ( nodedata->type == SENSOR ) { // node is a sensor
+            return 1;
+        } else { // node is the sink
+            return 2;
+        }
+    } else { // buffer drop
+        return 3;
+    }
+}
+
+int gradient_forward(call_t *c, struct packet_header *header) {
+    // original gradient: forward anything coming from deeper in the gradient
+    struct _node_private *nodedata = get_node_private_data(c);
+    if ( header->p_depth > nodedata->depth && nodedata->node_status == NODE_ON ) { 
+        return accept_data(c, header);
+    }
+    return 0;
+}
+
+uint64_t gradient_backoff(call_t *c, struct packet_header *header) {
+    // original gradient: uniform backoff in [0, Delay]
+    struct entitydata *entitydata = get_entity_private_data(c);
+    return get_random_time_range(0,entitydata->Delay);
+}
+
+int strict_forward(call_t *c, struct packet_header *header) {
+    // only the nodes exactly one hop closer to the sink forward
+    struct _node_private *nodedata = get_node_private_data(c);
+    if ( header->p_depth == nodedata->depth + 1 && nodedata->node_status == NODE_ON ) { 
+        return accept_data(c, header);
+    }
+    return 0;
+}
+
+double link_etx(call_t *c, struct packet_header *header) {
+    // estimate the delivery ratio of the link from header->p_src
+    // with the BUILD sequence numbers received versus the ones missed
+    // return the expected number of transmissions, 1/(p*p) assuming a symmetric link
+    struct _node_private *nodedata = get_node_private_data(c);
+    struct neighbor *n = NULL;
+    double p;
+    int i;
+
+    if ( nodedata->nbr_first < 0 ) {
+        nodedata->nbr_first = header->p_seqno;
+    }
+    for ( i = 0 ; i < nodedata->nbr_count ; i++ ) {
+        if ( nodedata->nbr[i].id == header->p_src ) {
+            n = &(nodedata->nbr[i]);
+            break;
+        }
+    }
+
+    if ( n == NULL ) {
+        if ( nodedata->nbr_count < NEIGHBOR ) {
+            n = &(nodedata->nbr[nodedata->nbr_count]);
+            nodedata->nbr_count ++;
+        } else { // table full, replace the neighbor heard the longest time ago
+            n = &(nodedata->nbr[0]);
+            for ( i = 1 ; i < NEIGHBOR ; i++ ) {
+                if ( nodedata->nbr[i].seqno < n->seqno ) {
+                    n = &(nodedata->nbr[i]);
+                }
+            }
+        }
+        // the rounds this node heard before count as missed on this link
+        n->id       = header->p_src;
+        n->seqno    = header->p_seqno;
+        n->recv     = 1;
+        n->expected = header->p_seqno - nodedata->nbr_first + 1;
+        if ( n->expected < 1 ) {
+            n->expected = 1;
+        }
+        if ( n->expected > ETX_WINDOW ) {
+            n->expected = ETX_WINDOW;
+        }
+    } else if ( header->p_seqno > n->seqno ) {
+        n->expected += header->p_seqno - n->seqno;
+        n->recv ++;
+        n->seqno = header->p_seqno;
+        // age the estimation
+        if ( n->expected > ETX_WINDOW ) {
+            n->expected = (n->expected + 1) / 2;
+            n->recv     = (n->recv + 1) / 2;
+        }
+    }
+
+    p = (double) n->recv / n->expected;
+    if ( p * p < 1.0 / ETX_MAX ) {
+        return ETX_MAX;
+    }
+    return 1.0 / (p * p);
+}
+
+int etx_parent(call_t *c, struct packet_header *header) {
+    // take any newer gradient, or a cheaper path in the current one
+    struct _node_private *nodedata = get_node_private_data(c);
+    double cost = header->p_cost + link_etx(c, header);
+    if( nodedata->seqno < header->p_seqno 
+        || ( nodedata->seqno == header->p_seqno && cost < nodedata->cost ) ) {
+        nodedata->seqno = header->p_seqno;
+        nodedata->depth = header->p_depth + 1;
+        nodedata->cost = cost;
+        nodedata->from = header->p_src;
+        return 1;
+    }
+    return 0;
+}
+
+int etx_forward(call_t *c, struct packet_header *header) {
+    // forward anything coming from a node with a higher cost to the sink
+    struct _node_private *nodedata = get_node_private_data(c);
+    if ( header->p_cost > nodedata->cost && nodedata->node_status == NODE_ON ) { 
+        return accept_data(c, header);
+    }
+    return 0;
+}
+
 
 /* ************************************************** */
 /* ************************************************** */
@@ -581,37 +1056,41 @@ void rx(call_t *c, packet_t *packet) {
  
     switch(header->p_type) {
         case BUILD:         
-            nodedata->node_status = NODE_ON;
-            if( nodedata->seqno < header->p_seqno ) {
-                nodedata->seqno = header->p_seqno;
-                nodedata->depth = header->p_depth + 1;
-                nodedata->from = header->p_src;
-                helper++;
+            if ( nodedata->node_status != NODE_ON && header->p_seqno == nodedata->lost_seqno 
+                 && header->p_cost >= nodedata->lost_cost ) {
+                // repairing, this node may be routing through us: taking it would create a loop
+                break;
             }
-            if( nodedata->depth > (header->p_depth + 1) ) {
-                nodedata->seqno = header->p_seqno;
-                nodedata->depth = header->p_depth + 1;
-                nodedata->from = header->p_src;
-                helper++;
+            nodedata->node_status = NODE_ON;
+            helper = entitydata->strategy->parent(c, header);
+            if (nodedata->status == MOVING && nodedata->from == header->p_src) {
+                // remember where the parent is
+                nodedata->from_x = header->p_pos_x;
+                nodedata->from_y = header->p_pos_y;
             }
             if (helper > 0 && nodedata->msg_status == MES_NO ) {
                 nodedata->msg_status = MES_BU;
-                scheduler_add_callback(get_time() + get_random_time_range(0,entitydata->Delay), c, tx_build, NULL); 
+                scheduler_add_callback(get_time() + entitydata->strategy->backoff(c, header), c, tx_build, NULL); 
             }
             break;
-        case DATA:
-            // node is not moving
-            if ( header->p_depth > nodedata->depth && nodedata->node_status == NODE_ON ) { 
-                if ( nodedata->buffer_pointer < BUFFER - 1  && check_seq(c, header->p_seqno) == 1 ) {
-                    if ( nodedata->type == SENSOR ) { // node is a sensor
-                        fwd = 1;
-                    } else { // node is the sink
-                        fwd = 2;
-                    }
-                } else { // buffer drop
-                    fwd = 3;
-                }
+        case REPAIR:
+            // a moving node lost its parent, answer with our gradient
+            // if we do not route through it (newer gradient or lower cost than it had)
+            // and it will still be in range at its next check, static nodes answer first
+            if ( nodedata->node_status == NODE_ON && nodedata->from != header->p_src 
+                 && nodedata->msg_status == MES_NO 
+                 && ( header->p_seqno < 0 || nodedata->seqno > header->p_seqno 
+                      || nodedata->cost < header->p_cost ) 
+                 && dpos(header->p_pos_x, header->p_pos_y, 
+                         get_node_position(c->node)->x, get_node_position(c->node)->y) <= entitydata->Range ) {
+                nodedata->msg_status = MES_BU;
+                scheduler_add_callback(get_time() + entitydata->strategy->backoff(c, header) 
+                                       + (nodedata->status == MOVING ? entitydata->Delay : 0), 
+                                       c, tx_build, REPAIR_ANSWER); 
             }
+            break;
+        case DATA:
+            fwd = entitydata->strategy->forward(c, header);
 
             if (fwd == 1){
                 (nodedata->p[nodedata->buffer_pointer]).p_src     = header->p_src;
@@ -619,6 +1098,7 @@ void rx(call_t *c, packet_t *packet) {
                 (nodedata->p[nodedata->buffer_pointer]).p_type    = header->p_type;
                 (nodedata->p[nodedata->buffer_pointer]).p_seqno   = header->p_seqno;
                 (nodedata->p[nodedata->buffer_pointer]).p_depth   = header->p_depth;
+                (nodedata->p[nodedata->buffer_pointer]).p_cost    = header->p_cost;
                 (nodedata->p[nodedata->buffer_pointer]).p_origin  = header->p_origin;
                 (nodedata->p[nodedata->buffer_pointer]).p_status  = header->p_status;
                 (nodedata->p[nodedata->buffer_pointer]).p_stamp   = header->p_stamp;
@@ -628,7 +1108,7 @@ void rx(call_t *c, packet_t *packet) {
                 nodedata->no_packet_recv ++ ;
                 add_seq(c, header->p_seqno);
                 scheduler_add_callback(get_time() + 
-                    get_random_time_range(0,entitydata->Delay), c, tx_forward, NULL);
+                    entitydata->strategy->backoff(c, header), c, tx_forward, NULL);
 #ifdef STATS
                 printf("[ENERGY] %lli (%i) %lli %i %i me:%i - %i\n", 
                     get_time(), header->p_origin, 
@@ -639,6 +1119,11 @@ void rx(call_t *c, packet_t *packet) {
 
             if (fwd == 2) {
                 nodedata->no_packet_recv ++ ;
+                if ( add_delivered(c, header->p_seqno) == 1 ) {
+                    entitydata->no_data_delivered ++ ;
+                } else {
+                    entitydata->no_data_duplicate ++ ;
+                }
 #ifdef STATS
                 printf("%lli (%i) %lli %i %i\n", 
                     get_time(), header->p_origin, 
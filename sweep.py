@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""
+Run a gradient simulation over a parameter grid and several seeds.
+
+The xml file is used as a template: ${Delay}, ${Period}, ${Jitter}, ${Buffer},
+${strategy}, ${seed}... are replaced by the values of each run, for example
+
+    <init Delay="${Delay}" Period="${Period}" Buffer="${Buffer}" strategy="${strategy}"/>
+
+Each run prints a "[SUMMARY] key=value ..." line at the end of the simulation
+(see destroy() in gr.c). All the runs are collected in one csv file and the
+mean and 95% confidence interval of every metric are printed per configuration.
+
+Example:
+    sweep.py -t gradient.xml -g Delay=0.1s,0.5s -g Buffer=5,10 \\
+             -g strategy=gradient,etx -s 10 -o results.csv
+"""
+import argparse
+import csv
+import itertools
+import math
+import os
+import shlex
+import string
+import subprocess
+import sys
+import tempfile
+import time
+from concurrent.futures import ThreadPoolExecutor, as_completed
+
+# Student t quantiles (0.975) for 1..30 degrees of freedom
+T975 = [12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042]
+
+
+def parse_grid(items):
+    # "Delay=0.1s,0.5s" -> ("Delay", ["0.1s", "0.5s"])
+    grid = []
+    for item in items:
+        key, sep, values = item.partition("=")
+        if not sep or not values:
+            sys.exit("sweep: bad grid parameter '%s', expected key=v1,v2,..." % item)
+        grid.append((key, values.split(",")))
+    return grid
+
+
+def parse_summary(output):
+    # keep the numeric values of the last [SUMMARY] line
+    stats = {}
+    for line in output.splitlines():
+        if not line.startswith("[SUMMARY]"):
+            continue
+        stats = {}
+        for token in line.split()[1:]:
+            key, sep, value = token.partition("=")
+            if not sep:
+                continue
+            try:
+                stats[key] = float(value)
+            except ValueError:
+                pass
+    return stats
+
+
+def placeholders(template):
+    # names of the ${key} / $key placeholders of a string.Template
+    names = set()
+    for match in template.pattern.finditer(template.template):
+        name = match.group("named") or match.group("braced")
+        if name:
+            names.add(name)
+    return names
+
+
+def confidence(values):
+    # return mean and 95% confidence interval half width
+    n = len(values)
+    mean = sum(values) / n
+    if n < 2:
+        return mean, 0.0
+    var = sum((v - mean) ** 2 for v in values) / (n - 1)
+    t = T975[n - 2] if n - 1 <= len(T975) else 1.960
+    return mean, t * math.sqrt(var / n)
+
+
+def run(job, args, template, workdir):
+    config, seed = job
+    values = dict(config)
+    values["seed"] = str(seed)
+    name = "_".join("%s-%s" % kv for kv in config) or "default"
+    xml = os.path.join(workdir, "%s_s%d.xml" % (name, seed))
+    with open(xml, "w") as f:
+        f.write(template.substitute(values))
+
+    cmd = [a.format(wsnet=args.wsnet, xml=xml, seed=seed) for a in shlex.split(args.cmd)]
+    start = time.time()
+    try:
+        proc = subprocess.run(cmd, cwd=args.cwd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                              universal_newlines=True, timeout=args.timeout)
+        output, status = proc.stdout, proc.returncode
+    except subprocess.TimeoutExpired as e:
+        # the partial output is bytes even with universal_newlines
+        output, status = e.stdout or "", "timeout"
+        if isinstance(output, bytes):
+            output = output.decode(errors="replace")
+    except OSError as e:
+        # missing or not executable simulator
+        output, status = "", "%s: %s" % (type(e).__name__, e.strerror or e)
+    elapsed = time.time() - start
+
+    if args.keep:
+        with open(xml[:-4] + ".log", "w") as f:
+            f.write(output)
+    return config, seed, status, elapsed, parse_summary(output)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-t", "--template", required=True, help="xml template")
+    parser.add_argument("-g", "--grid", action="append", default=[], metavar="KEY=V1,V2",
+                        help="parameter values, can be repeated")
+    parser.add_argument("-s", "--seeds", type=int, default=5, help="number of seeds per configuration")
+    parser.add_argument("--first-seed", type=int, default=1)
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count() or 1, help="parallel simulations")
+    parser.add_argument("--wsnet", default="wsnet", help="simulator binary, a stand-in can be used")
+    parser.add_argument("--cmd", default="{wsnet} -c {xml}", help="command line of one run")
+    parser.add_argument("--cwd", help="directory the simulator runs in (default: template directory)")
+    parser.add_argument("--timeout", type=float, help="seconds before a run is killed")
+    parser.add_argument("--workdir", help="where the xml variants are written (default: temporary)")
+    parser.add_argument("--keep", action="store_true", help="keep the output of every run in workdir")
+    parser.add_argument("-o", "--output", help="csv file with every run")
+    args = parser.parse_args()
+
+    with open(args.template) as f:
+        template = string.Template(f.read())
+    grid = parse_grid(args.grid)
+    names = placeholders(template)
+    for key, _ in grid:
+        if key not in names:
+            sys.exit("sweep: '%s' does not appear in %s" % (key, args.template))
+    unfilled = names - set(key for key, _ in grid) - {"seed"}
+    if unfilled:
+        sys.exit("sweep: no value for %s in %s, add them to the grid" %
+                 (", ".join(sorted(unfilled)), args.template))
+    if "seed" not in names and "{seed}" not in args.cmd:
+        sys.exit("sweep: neither %s nor --cmd use the seed, all the runs would be identical" % args.template)
+    if args.cwd is None:
+        args.cwd = os.path.dirname(os.path.abspath(args.template))
+    # runs are started in args.cwd, a relative path is relative to where sweep.py is called
+    if os.sep in args.wsnet or (os.altsep and os.altsep in args.wsnet):
+        args.wsnet = os.path.abspath(args.wsnet)
+
+    if args.workdir:
+        os.makedirs(args.workdir, exist_ok=True)
+        return sweep(args, template, grid, args.workdir)
+    if args.keep:
+        workdir = tempfile.mkdtemp(prefix="sweep_")
+        print("sweep: runs kept in %s" % workdir, file=sys.stderr)
+        return sweep(args, template, grid, workdir)
+    with tempfile.TemporaryDirectory(prefix="sweep_") as workdir:
+        return sweep(args, template, grid, workdir)
+
+
+def sweep(args, template, grid, workdir):
+    # run every configuration and seed, write the csv and print the aggregate
+    keys = [key for key, _ in grid]
+    configs = [tuple(zip(keys, values)) for values in itertools.product(*[v for _, v in grid])]
+    seeds = range(args.first_seed, args.first_seed + args.seeds)
+    jobs = list(itertools.product(configs, seeds))
+
+    results = []
+    failed = 0
+    with ThreadPoolExecutor(max_workers=max(1, args.jobs)) as pool:
+        futures = [pool.submit(run, job, args, template, workdir) for job in jobs]
+        for i, future in enumerate(as_completed(futures), 1):
+            config, seed, status, elapsed, stats = future.result()
+            if status != 0 or not stats:
+                failed += 1
+                print("sweep: %s seed %d failed (%s)" % (dict(config), seed, status), file=sys.stderr)
+            print("sweep: %d/%d done" % (i, len(jobs)), file=sys.stderr)
+            results.append((config, seed, status, elapsed, stats))
+
+    results.sort(key=lambda r: (configs.index(r[0]), r[1]))
+    metrics = sorted({m for r in results for m in r[4]})
+
+    if args.output:
+        with open(args.output, "w", newline="") as f:
+            writer = csv.writer(f)
+            writer.writerow(keys + ["seed", "status", "time"] + metrics)
+            for config, seed, status, elapsed, stats in results:
+                writer.writerow([v for _, v in config] + [seed, status, "%.2f" % elapsed] +
+                                [stats.get(m, "") for m in metrics])
+
+    # one line per configuration: mean +- 95% confidence interval
+    print("\t".join(keys + ["runs"] + metrics))
+    for config in configs:
+        runs = [r[4] for r in results if r[0] == config and r[2] == 0 and r[4]]
+        row = [v for _, v in config] + [str(len(runs))]
+        for m in metrics:
+            values = [s[m] for s in runs if m in s]
+            if values:
+                mean, ci = confidence(values)
+                row.append("%.4g+-%.2g" % (mean, ci))
+            else:
+                row.append("-")
+        print("\t".join(row))
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())